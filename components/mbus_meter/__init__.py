@@ -1,18 +1,71 @@
 import esphome.codegen as cg
 import esphome.config_validation as cv
-from esphome.components import uart
-from esphome.const import CONF_ID
+import esphome.final_validate as fv
+from esphome import pins
+from esphome.components import time as time_, uart, web_server_base
+from esphome.components.esp32 import add_idf_sdkconfig_option
+from esphome.components.web_server_base import CONF_WEB_SERVER_BASE_ID
+from esphome.const import (
+    CONF_ID,
+    CONF_NUMBER,
+    CONF_PATH,
+    CONF_POWER_SAVE_MODE,
+    CONF_RX_PIN,
+    CONF_SIZE,
+    CONF_TIME_ID,
+    CONF_UART_ID,
+)
 
 DEPENDENCIES = ["uart"]
 CODEOWNERS = ["@karllinder"]
 
 mbus_meter_ns = cg.esphome_ns.namespace("mbus_meter")
 MbusMeter = mbus_meter_ns.class_("MbusMeter", cg.Component, uart.UARTDevice)
+HistoryExport = mbus_meter_ns.class_("HistoryExport", cg.Component)
+
+CONF_LIGHT_SLEEP = "light_sleep"
+CONF_WAKEUP_PIN = "wakeup_pin"
+CONF_WAKEUP_MARGIN = "wakeup_margin"
+CONF_MIN_SLEEP = "min_sleep"
+CONF_HISTORY = "history"
+CONF_CAPACITY_TARIFF = "capacity_tariff"
+CONF_STEPS = "steps"
+
+LIGHT_SLEEP_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_WAKEUP_PIN): pins.internal_gpio_input_pin_number,
+        cv.Optional(CONF_WAKEUP_MARGIN, default="100ms"): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_MIN_SLEEP, default="50ms"): cv.positive_time_period_milliseconds,
+    }
+)
+
+HISTORY_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(HistoryExport),
+        cv.GenerateID(CONF_WEB_SERVER_BASE_ID): cv.use_id(web_server_base.WebServerBase),
+        cv.Optional(CONF_TIME_ID): cv.use_id(time_.RealTimeClock),
+        cv.Optional(CONF_SIZE, default=32768): cv.int_range(min=1024, max=65536),
+        cv.Optional(CONF_PATH, default="/mbus_meter/history"): cv.string_strict,
+    }
+)
+
+# Default step limits in kW, as used by most Norwegian grid companies
+CAPACITY_TARIFF_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_TIME_ID): cv.use_id(time_.RealTimeClock),
+        cv.Optional(CONF_STEPS, default=[2, 5, 10, 15, 20, 25, 50, 75, 100]): cv.All(
+            cv.ensure_list(cv.positive_float), cv.Length(min=1)
+        ),
+    }
+)
 
 CONFIG_SCHEMA = cv.All(
     cv.Schema(
         {
             cv.GenerateID(): cv.declare_id(MbusMeter),
+            cv.Optional(CONF_LIGHT_SLEEP): cv.All(LIGHT_SLEEP_SCHEMA, cv.only_with_esp_idf),
+            cv.Optional(CONF_HISTORY): HISTORY_SCHEMA,
+            cv.Optional(CONF_CAPACITY_TARIFF): CAPACITY_TARIFF_SCHEMA,
         }
     )
     .extend(cv.COMPONENT_SCHEMA)
@@ -20,7 +73,61 @@ CONFIG_SCHEMA = cv.All(
 )
 
 
+
+def _final_validate(config):
+    if CONF_LIGHT_SLEEP not in config:
+        return
+    full_config = fv.full_config.get()
+
+    # The wakeup pin watches the meter line for frames arriving while asleep
+    uart_path = full_config.get_path_for_id(config[CONF_UART_ID])[:-1]
+    uart_config = full_config.get_config_for_path(uart_path)
+    rx_pin = uart_config.get(CONF_RX_PIN)
+    if rx_pin is None or rx_pin[CONF_NUMBER] != config[CONF_LIGHT_SLEEP][CONF_WAKEUP_PIN]:
+        raise cv.Invalid(
+            f"{CONF_WAKEUP_PIN} must be the rx_pin of the meter's UART bus",
+            path=[CONF_LIGHT_SLEEP, CONF_WAKEUP_PIN],
+        )
+
+    # Automatic light sleep only keeps the WiFi link up together with modem sleep
+    wifi_config = full_config.get("wifi")
+    if wifi_config is not None and wifi_config.get(CONF_POWER_SAVE_MODE) == "NONE":
+        raise cv.Invalid(
+            f"{CONF_LIGHT_SLEEP} needs WiFi modem sleep, set wifi {CONF_POWER_SAVE_MODE} to LIGHT or HIGH",
+            path=[CONF_LIGHT_SLEEP],
+        )
+
+
+FINAL_VALIDATE_SCHEMA = _final_validate
+
+
 async def to_code(config):
     var = cg.new_Pvariable(config[CONF_ID])
     await cg.register_component(var, config)
-    await uart.register_uart_device(var, config)
\ No newline at end of file
+    await uart.register_uart_device(var, config)
+
+    if CONF_LIGHT_SLEEP in config:
+        conf = config[CONF_LIGHT_SLEEP]
+        add_idf_sdkconfig_option("CONFIG_PM_ENABLE", True)
+        add_idf_sdkconfig_option("CONFIG_FREERTOS_USE_TICKLESS_IDLE", True)
+        cg.add(var.set_light_sleep_wakeup_pin(conf[CONF_WAKEUP_PIN]))
+        cg.add(var.set_light_sleep_margin(conf[CONF_WAKEUP_MARGIN]))
+        cg.add(var.set_light_sleep_min_duration(conf[CONF_MIN_SLEEP]))
+
+    if CONF_HISTORY in config:
+        conf = config[CONF_HISTORY]
+        cg.add_define("USE_MBUS_METER_HISTORY")
+        cg.add(var.set_history_capacity(conf[CONF_SIZE]))
+        # Served by a separate component that only starts once the network is up
+        base = await cg.get_variable(conf[CONF_WEB_SERVER_BASE_ID])
+        export = cg.new_Pvariable(conf[CONF_ID], base, var, conf[CONF_PATH])
+        await cg.register_component(export, conf)
+        if CONF_TIME_ID in conf:
+            clock = await cg.get_variable(conf[CONF_TIME_ID])
+            cg.add(var.set_history_time(clock))
+
+    if CONF_CAPACITY_TARIFF in config:
+        conf = config[CONF_CAPACITY_TARIFF]
+        clock = await cg.get_variable(conf[CONF_TIME_ID])
+        cg.add(var.set_capacity_time(clock))
+        cg.add(var.set_capacity_steps(sorted(conf[CONF_STEPS])))
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include "capacity_tracker.h"
+
+namespace esphome {
+namespace mbus_meter {
+
+void CapacityTracker::set_state(const CapacityState &state) {
+  this->state_ = state;
+  // Judge the first reading after a restore against the start of the saved hour
+  this->last_timestamp_ = state.hour * 3600;
+  this->last_energy_ = state.hour_start_energy;
+  this->candidate_count_ = 0;
+}
+
+bool CapacityTracker::is_plausible(uint32_t timestamp, uint32_t energy_wh, uint32_t base_timestamp,
+                                   uint32_t base_energy_wh) {
+  if (timestamp < base_timestamp || energy_wh < base_energy_wh) return false;
+  uint64_t max_wh = static_cast<uint64_t>(MAX_POWER_W) * (timestamp - base_timestamp) / 3600 + COUNTER_SLACK_WH;
+  return energy_wh - base_energy_wh <= max_wh;
+}
+
+bool CapacityTracker::update(uint32_t timestamp, uint16_t year, uint8_t month, uint8_t day, uint32_t energy_wh) {
+  uint32_t hour = timestamp / 3600;
+  uint16_t month_key = year * 12 + month - 1;
+
+  if (!this->is_tracking()) {
+    if (month_key != this->state_.month) this->clear_peaks();
+    this->start_hour(hour, month_key, day, energy_wh);
+    this->last_timestamp_ = timestamp;
+    this->last_energy_ = energy_wh;
+    return false;
+  }
+
+  if (!is_plausible(timestamp, energy_wh, this->last_timestamp_, this->last_energy_)) {
+    // A glitched frame is dropped. A new baseline (meter swap, clock jump) is
+    // only followed once enough readings in a row agree with it.
+    if (this->candidate_count_ > 0 &&
+        is_plausible(timestamp, energy_wh, this->candidate_timestamp_, this->candidate_energy_)) {
+      this->candidate_count_++;
+    } else {
+      this->candidate_count_ = 1;
+    }
+    this->candidate_timestamp_ = timestamp;
+    this->candidate_energy_ = energy_wh;
+    if (this->candidate_count_ < RESYNC_READINGS) return false;
+
+    // Restart without closing an hour, the consumption across the jump is unknown
+    this->candidate_count_ = 0;
+    if (month_key != this->state_.month) this->clear_peaks();
+    this->start_hour(hour, month_key, day, energy_wh);
+    this->last_timestamp_ = timestamp;
+    this->last_energy_ = energy_wh;
+    return false;
+  }
+
+  this->candidate_count_ = 0;
+  this->last_timestamp_ = timestamp;
+  this->last_energy_ = energy_wh;
+  if (hour == this->state_.hour) return false;
+
+  // The first reading of a new hour closes the previous one. If readings were
+  // missing for several hours, spreading the consumption evenly is a lower bound.
+  uint32_t hours = hour - this->state_.hour;
+  this->record_peak(this->state_.day, (energy_wh - this->state_.hour_start_energy) / hours);
+
+  if (month_key != this->state_.month) this->clear_peaks();
+  this->start_hour(hour, month_key, day, energy_wh);
+  return true;
+}
+
+uint32_t CapacityTracker::get_hour_energy() const {
+  if (!this->is_tracking()) return 0;
+  return this->last_energy_ - this->state_.hour_start_energy;
+}
+
+float CapacityTracker::get_peak_average() const {
+  uint32_t sum = 0;
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < 3; i++) {
+    if (this->state_.peak_day[i] == 0) continue;
+    sum += this->state_.peak_energy[i];
+    count++;
+  }
+  return count == 0 ? 0.0f : sum / 1000.0f / count;
+}
+
+uint8_t CapacityTracker::get_step() const {
+  float average = this->get_peak_average();
+  uint8_t step = 1;
+  for (float limit : this->step_limits_) {
+    if (average < limit) break;
+    step++;
+  }
+  return step;
+}
+
+void CapacityTracker::start_hour(uint32_t hour, uint16_t month, uint8_t day, uint32_t energy_wh) {
+  this->state_.hour = hour;
+  this->state_.month = month;
+  this->state_.day = day;
+  this->state_.hour_start_energy = energy_wh;
+}
+
+void CapacityTracker::record_peak(uint8_t day, uint32_t energy_wh) {
+  // Only the highest hour of each day counts
+  for (uint8_t i = 0; i < 3; i++) {
+    if (this->state_.peak_day[i] != day) continue;
+    if (energy_wh > this->state_.peak_energy[i]) this->state_.peak_energy[i] = energy_wh;
+    return;
+  }
+
+  // Otherwise take a free slot, or replace the lowest peak if this hour beats it
+  uint8_t slot = 0;
+  for (uint8_t i = 0; i < 3; i++) {
+    if (this->state_.peak_day[i] == 0) {
+      slot = i;
+      break;
+    }
+    if (this->state_.peak_energy[i] < this->state_.peak_energy[slot]) slot = i;
+  }
+  if (this->state_.peak_day[slot] == 0 || energy_wh > this->state_.peak_energy[slot]) {
+    this->state_.peak_day[slot] = day;
+    this->state_.peak_energy[slot] = energy_wh;
+  }
+}
+
+void CapacityTracker::clear_peaks() {
+  for (uint8_t i = 0; i < 3; i++) {
+    this->state_.peak_day[i] = 0;
+    this->state_.peak_energy[i] = 0;
+  }
+}
+
+}  // namespace mbus_meter
+}  // namespace esphome
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace esphome {
+namespace mbus_meter {
+
+// Everything needed to resume tracking after a reboot, stored as a preference
+struct CapacityState {
+  uint32_t hour{0};                  // UTC hours since epoch of the running hour, 0 when not tracking
+  uint32_t hour_start_energy{0};     // Wh
+  uint16_t month{0};                 // year * 12 + month - 1 of the running hour
+  uint8_t day{0};                    // day of month of the running hour
+  uint8_t peak_day[3]{0, 0, 0};      // 0 marks an unused slot
+  uint32_t peak_energy[3]{0, 0, 0};  // Wh
+};
+
+// Tracks hourly consumption from the cumulative import counter and keeps the
+// three highest hours of the month, at most one per day, as used by the
+// Norwegian capacity tariff (kapasitetsledd). Counter readings that run
+// backwards or jump faster than any household can draw are dropped.
+class CapacityTracker {
+ public:
+  // Upper bounds of each tariff step in kW, ascending
+  void set_step_limits(const std::vector<float> &limits) { step_limits_ = limits; }
+  void set_state(const CapacityState &state);
+  const CapacityState &get_state() const { return state_; }
+
+  // Feed a counter reading with its UTC timestamp and local date. Returns true
+  // when an hour was closed, i.e. the state should be saved.
+  bool update(uint32_t timestamp, uint16_t year, uint8_t month, uint8_t day, uint32_t energy_wh);
+
+  bool is_tracking() const { return state_.hour != 0; }
+  // Consumption since the start of the running hour, from the last accepted reading
+  uint32_t get_hour_energy() const;
+  // Average of the monthly peaks in kWh/h, over the days recorded so far
+  float get_peak_average() const;
+  uint8_t get_step() const;
+
+ protected:
+  void start_hour(uint32_t hour, uint16_t month, uint8_t day, uint32_t energy_wh);
+  void record_peak(uint8_t day, uint32_t energy_wh);
+  void clear_peaks();
+  static bool is_plausible(uint32_t timestamp, uint32_t energy_wh, uint32_t base_timestamp, uint32_t base_energy_wh);
+
+  CapacityState state_;
+  std::vector<float> step_limits_;
+  uint32_t last_timestamp_{0};
+  uint32_t last_energy_{0};
+  // Readings that disagree with the baseline but agree with each other
+  uint32_t candidate_timestamp_{0};
+  uint32_t candidate_energy_{0};
+  uint8_t candidate_count_{0};
+
+  // Well above any residential main fuse (3 x 125 A at 400 V is ~87 kW)
+  static const uint32_t MAX_POWER_W = 100000;
+  // Allowance for the 10 Wh counter resolution
+  static const uint32_t COUNTER_SLACK_WH = 50;
+  // Consistent out-of-line readings in a row before they become the new
+  // baseline, e.g. after a meter swap; about five minutes of A1 frames
+  static const uint8_t RESYNC_READINGS = 30;
+};
+
+}  // namespace mbus_meter
+}  // namespace esphome
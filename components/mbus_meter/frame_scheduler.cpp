@@ -0,0 +1,164 @@
+#include "frame_scheduler.h"
+
+#include <cmath>
+#include <initializer_list>
+
+namespace esphome {
+namespace mbus_meter {
+
+void FrameCadence::start(uint32_t start_ms) {
+  this->last_start_ms_ = start_ms;
+  this->period_ms_ = 0.0f;
+  this->jitter_ms_ = 0.0f;
+  this->samples_ = 1;
+  this->outliers_ = 0;
+}
+
+void FrameCadence::record_frame(uint32_t start_ms) {
+  if (this->samples_ == 0) {
+    this->start(start_ms);
+    return;
+  }
+
+  // Unsigned difference stays correct across millis() wraparound
+  uint32_t gap = start_ms - this->last_start_ms_;
+  if (gap == 0) return;
+
+  if (this->is_locked()) {
+    // A frame off the learned grid must not shift it; keep predicting from the
+    // last on-grid frame unless the meter has clearly changed its cadence
+    float periods = roundf(gap / this->period_ms_);
+    float offset = fabsf(gap - periods * this->period_ms_);
+    if (periods < 1.0f || offset > this->get_margin_ms()) {
+      if (++this->outliers_ >= MAX_OUTLIERS) this->start(start_ms);
+      return;
+    }
+    this->outliers_ = 0;
+  }
+  this->last_start_ms_ = start_ms;
+
+  // First gap, or the stream turned out to run faster than learned so far
+  if (this->period_ms_ <= 0.0f || gap < this->period_ms_ / 2.0f) {
+    this->period_ms_ = gap;
+    this->jitter_ms_ = 0.0f;
+    this->samples_ = 2;
+    return;
+  }
+
+  // Lost frames show up as gaps spanning several periods
+  float periods = roundf(gap / this->period_ms_);
+  if (periods > MAX_MISSED_PERIODS) return;
+
+  float error = gap / periods - this->period_ms_;
+  this->period_ms_ += error / 8.0f;
+  this->jitter_ms_ += (fabsf(error) - this->jitter_ms_) / 4.0f;
+  this->extra_margin_ms_ -= this->extra_margin_ms_ / 16.0f;
+  if (this->samples_ < LOCK_SAMPLES) this->samples_++;
+}
+
+void FrameCadence::record_early_wakeup() {
+  this->extra_margin_ms_ = this->extra_margin_ms_ * 2.0f + this->base_margin_ms_;
+  if (this->extra_margin_ms_ > this->max_margin_ms_) this->extra_margin_ms_ = this->max_margin_ms_;
+}
+
+void FrameCadence::reset() {
+  this->last_start_ms_ = 0;
+  this->period_ms_ = 0.0f;
+  this->jitter_ms_ = 0.0f;
+  this->extra_margin_ms_ = 0.0f;
+  this->samples_ = 0;
+  this->outliers_ = 0;
+}
+
+uint32_t FrameCadence::get_margin_ms() const {
+  float margin = this->base_margin_ms_ + 4.0f * this->jitter_ms_ + this->extra_margin_ms_;
+  if (margin > this->max_margin_ms_) margin = this->max_margin_ms_;
+  return (uint32_t) margin;
+}
+
+uint32_t FrameCadence::sleep_budget(uint32_t now_ms) const {
+  if (!this->is_locked()) return 0;
+
+  float margin = this->get_margin_ms();
+  float elapsed = now_ms - this->last_start_ms_;
+  if (elapsed > this->period_ms_ * MAX_MISSED_PERIODS) return 0;
+
+  // Each predicted arrival k * period is guarded by a +/- margin window; stay
+  // awake inside a window so late frames are caught too, else sleep to the next one
+  float k = ceilf((elapsed - margin) / this->period_ms_);
+  if (k < 1.0f) k = 1.0f;
+  float wake_at = k * this->period_ms_ - margin;
+  if (elapsed >= wake_at) return 0;
+  return (uint32_t) (wake_at - elapsed);
+}
+
+float FrameCadence::arrival_offset_ms(uint32_t now_ms) const {
+  float elapsed = now_ms - this->last_start_ms_;
+  float k = roundf(elapsed / this->period_ms_);
+  if (k < 1.0f) k = 1.0f;
+  return fabsf(elapsed - k * this->period_ms_);
+}
+
+void FrameScheduler::set_base_margin(uint32_t margin_ms) {
+  this->cadence_2a_.set_base_margin(margin_ms);
+  this->cadence_a1_.set_base_margin(margin_ms);
+}
+
+FrameCadence *FrameScheduler::cadence_for(uint8_t frame_type) {
+  return frame_type == 0xA1 ? &this->cadence_a1_ : &this->cadence_2a_;
+}
+
+void FrameScheduler::record_frame(uint8_t frame_type, uint32_t start_ms) {
+  if (!this->seen_frame_) {
+    this->seen_frame_ = true;
+    this->first_frame_ms_ = start_ms;
+  } else if (start_ms - this->first_frame_ms_ >= LEARN_MS) {
+    this->learned_ = true;
+  }
+  this->cadence_for(frame_type)->record_frame(start_ms);
+}
+
+void FrameScheduler::record_rx_wakeup(uint32_t now_ms) {
+  FrameCadence *nearest = nullptr;
+  float nearest_offset = 0.0f;
+  for (FrameCadence *cadence : {&this->cadence_2a_, &this->cadence_a1_}) {
+    if (!cadence->is_locked()) continue;
+    float offset = cadence->arrival_offset_ms(now_ms);
+    if (nearest == nullptr || offset < nearest_offset) {
+      nearest = cadence;
+      nearest_offset = offset;
+    }
+  }
+  if (nearest != nullptr) {
+    nearest->record_early_wakeup();
+    return;
+  }
+
+  // Nothing to attribute it to, widen every cadence seen so far
+  for (FrameCadence *cadence : {&this->cadence_2a_, &this->cadence_a1_}) {
+    if (cadence->has_frames()) cadence->record_early_wakeup();
+  }
+}
+
+void FrameScheduler::reset() {
+  this->cadence_2a_.reset();
+  this->cadence_a1_.reset();
+  this->seen_frame_ = false;
+  this->learned_ = false;
+}
+
+uint32_t FrameScheduler::sleep_budget(uint32_t now_ms) const {
+  if (!this->learned_) return 0;
+
+  // A frame type the meter never sent does not constrain sleep
+  uint32_t budget = UINT32_MAX;
+  for (const FrameCadence *cadence : {&this->cadence_2a_, &this->cadence_a1_}) {
+    if (!cadence->has_frames()) continue;
+    uint32_t cadence_budget = cadence->sleep_budget(now_ms);
+    if (cadence_budget < budget) budget = cadence_budget;
+  }
+  return budget == UINT32_MAX ? 0 : budget;
+}
+
+}  // namespace mbus_meter
+}  // namespace esphome
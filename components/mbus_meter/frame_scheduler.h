@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome {
+namespace mbus_meter {
+
+// Learns the period and jitter of one stream of frames from their start times
+class FrameCadence {
+ public:
+  void set_base_margin(uint32_t margin_ms) { base_margin_ms_ = margin_ms; }
+  void set_max_margin(uint32_t margin_ms) { max_margin_ms_ = margin_ms; }
+
+  void record_frame(uint32_t start_ms);
+  // A frame arrived while sleep was allowed, so the margin was too tight
+  void record_early_wakeup();
+  void reset();
+
+  // Milliseconds until the next arrival window opens, 0 inside a window
+  uint32_t sleep_budget(uint32_t now_ms) const;
+  // Distance from now_ms to the nearest predicted arrival, in ms
+  float arrival_offset_ms(uint32_t now_ms) const;
+
+  bool has_frames() const { return samples_ > 0; }
+  bool is_locked() const { return samples_ >= LOCK_SAMPLES; }
+  float get_period_ms() const { return period_ms_; }
+  float get_jitter_ms() const { return jitter_ms_; }
+  uint32_t get_margin_ms() const;
+
+ protected:
+  void start(uint32_t start_ms);
+
+  uint32_t last_start_ms_{0};
+  float period_ms_{0.0f};
+  float jitter_ms_{0.0f};
+  float extra_margin_ms_{0.0f};
+  uint8_t samples_{0};
+  uint8_t outliers_{0};
+  uint32_t base_margin_ms_{100};
+  uint32_t max_margin_ms_{1000};
+
+  static const uint8_t LOCK_SAMPLES = 4;
+  // Without a frame for this many periods the meter has drifted or stopped
+  static const uint8_t MAX_MISSED_PERIODS = 4;
+  // Consecutive off-cadence frames before the learned period is dropped
+  static const uint8_t MAX_OUTLIERS = 3;
+};
+
+// Predicts how long the reader may sleep before the next 2A or A1 frame. The
+// two frame types run on independent cadences, so each is learned separately.
+class FrameScheduler {
+ public:
+  void set_base_margin(uint32_t margin_ms);
+
+  // Feed the receive time of the first byte of every valid 2A/A1 frame
+  void record_frame(uint8_t frame_type, uint32_t start_ms);
+  // Bytes arrived while sleep was allowed. The wakeup usually corrupts the frame
+  // header, so the margin of the cadence expecting a frame nearest to now is widened.
+  void record_rx_wakeup(uint32_t now_ms);
+  void reset();
+
+  // Milliseconds the caller may sleep starting at now_ms, 0 to stay awake
+  uint32_t sleep_budget(uint32_t now_ms) const;
+
+  const FrameCadence &get_cadence_2a() const { return cadence_2a_; }
+  const FrameCadence &get_cadence_a1() const { return cadence_a1_; }
+
+ protected:
+  FrameCadence *cadence_for(uint8_t frame_type);
+
+  FrameCadence cadence_2a_;
+  FrameCadence cadence_a1_;
+  uint32_t first_frame_ms_{0};
+  bool seen_frame_{false};
+  bool learned_{false};
+
+  // Listen this long after the first frame before trusting that a frame type
+  // which has not shown up yet is not sent at all
+  static const uint32_t LEARN_MS = 60000;
+};
+
+}  // namespace mbus_meter
+}  // namespace esphome
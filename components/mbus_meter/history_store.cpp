@@ -0,0 +1,157 @@
+#include "history_store.h"
+
+#include <cstring>
+
+namespace esphome {
+namespace mbus_meter {
+
+static uint32_t HistoryRecord::*const FIELDS[] = {
+    &HistoryRecord::timestamp,       &HistoryRecord::power,
+    &HistoryRecord::reactive_power,  &HistoryRecord::energy,
+    &HistoryRecord::reactive_energy, &HistoryRecord::reactive_export_energy,
+    &HistoryRecord::current_l1,      &HistoryRecord::current_l2,
+    &HistoryRecord::current_l3,      &HistoryRecord::voltage_l1,
+    &HistoryRecord::voltage_l2,      &HistoryRecord::voltage_l3,
+};
+static const size_t FIELD_COUNT = sizeof(FIELDS) / sizeof(FIELDS[0]);
+// A 32-bit varint takes at most 5 bytes
+static const size_t MAX_RECORD_BYTES = FIELD_COUNT * 5;
+
+bool HistoryStore::init(uint8_t *buffer, size_t size) {
+  size_t blocks = size / BLOCK_FOOTPRINT;
+  if (buffer == nullptr || blocks == 0 || blocks > UINT16_MAX) return false;
+
+  std::lock_guard<std::mutex> guard(this->lock_);
+  this->data_ = buffer;
+  this->block_used_ = reinterpret_cast<uint16_t *>(buffer + blocks * BLOCK_SIZE);
+  this->block_records_ = this->block_used_ + blocks;
+  this->blocks_ = blocks;
+  this->head_block_ = 0;
+  this->block_count_ = 0;
+  this->head_sequence_ = 0;
+  this->record_count_ = 0;
+  this->last_ = HistoryRecord{};
+  return true;
+}
+
+size_t HistoryStore::encode(const HistoryRecord &record, const HistoryRecord &base, uint8_t *out) {
+  size_t pos = 0;
+  for (auto field : FIELDS) {
+    // Differences wrap modulo 2^32, zigzag keeps small negative steps short
+    int32_t delta = static_cast<int32_t>(record.*field - base.*field);
+    uint32_t value = (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+    while (value >= 0x80) {
+      out[pos++] = static_cast<uint8_t>(value) | 0x80;
+      value >>= 7;
+    }
+    out[pos++] = static_cast<uint8_t>(value);
+  }
+  return pos;
+}
+
+size_t HistoryStore::decode(const uint8_t *in, size_t length, const HistoryRecord &base, HistoryRecord *record) {
+  size_t pos = 0;
+  for (auto field : FIELDS) {
+    uint32_t value = 0;
+    uint8_t shift = 0;
+    while (true) {
+      if (pos >= length || shift > 28) return 0;
+      uint8_t byte = in[pos++];
+      value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) break;
+      shift += 7;
+    }
+    uint32_t delta = (value >> 1) ^ (~(value & 1) + 1);
+    record->*field = base.*field + delta;
+  }
+  return pos;
+}
+
+void HistoryStore::append(const HistoryRecord &record) {
+  std::lock_guard<std::mutex> guard(this->lock_);
+  if (this->blocks_ == 0) return;
+
+  uint8_t scratch[MAX_RECORD_BYTES];
+  if (this->block_count_ > 0) {
+    uint16_t tail = (this->head_block_ + this->block_count_ - 1) % this->blocks_;
+    size_t length = encode(record, this->last_, scratch);
+    if (this->block_used_[tail] + length <= BLOCK_SIZE) {
+      memcpy(&this->data_[tail * BLOCK_SIZE + this->block_used_[tail]], scratch, length);
+      this->block_used_[tail] += length;
+      this->block_records_[tail]++;
+      this->record_count_++;
+      this->last_ = record;
+      return;
+    }
+  }
+
+  // Open a new block, dropping the oldest one when the ring is full
+  if (this->block_count_ == this->blocks_) {
+    this->record_count_ -= this->block_records_[this->head_block_];
+    this->head_block_ = (this->head_block_ + 1) % this->blocks_;
+    this->head_sequence_++;
+    this->block_count_--;
+  }
+  uint16_t tail = (this->head_block_ + this->block_count_) % this->blocks_;
+  this->block_count_++;
+
+  size_t length = encode(record, HistoryRecord{}, scratch);
+  memcpy(&this->data_[tail * BLOCK_SIZE], scratch, length);
+  this->block_used_[tail] = length;
+  this->block_records_[tail] = 1;
+  this->record_count_++;
+  this->last_ = record;
+}
+
+size_t HistoryStore::read(HistoryCursor *cursor, uint32_t since, HistoryRecord *records, size_t max_records) const {
+  std::lock_guard<std::mutex> guard(this->lock_);
+  if (this->block_count_ == 0) return 0;
+
+  // Start at the oldest block, or skip ahead if the cursor's block was evicted
+  uint32_t last_sequence = this->head_sequence_ + this->block_count_ - 1;
+  if (!cursor->started || static_cast<int32_t>(cursor->block - this->head_sequence_) < 0) {
+    cursor->block = this->head_sequence_;
+    cursor->offset = 0;
+    cursor->started = true;
+  }
+
+  size_t count = 0;
+  while (count < max_records) {
+    uint16_t index = (this->head_block_ + (cursor->block - this->head_sequence_)) % this->blocks_;
+    uint16_t used = this->block_used_[index];
+    if (cursor->offset >= used) {
+      if (cursor->block == last_sequence) break;
+      cursor->block++;
+      cursor->offset = 0;
+      continue;
+    }
+
+    HistoryRecord base = cursor->offset == 0 ? HistoryRecord{} : cursor->previous;
+    size_t length = decode(&this->data_[index * BLOCK_SIZE + cursor->offset], used - cursor->offset, base,
+                           &cursor->previous);
+    if (length == 0) {
+      cursor->offset = used;
+      continue;
+    }
+    cursor->offset += length;
+    if (cursor->previous.timestamp >= since) records[count++] = cursor->previous;
+  }
+  return count;
+}
+
+size_t HistoryStore::get_bytes_used() const {
+  std::lock_guard<std::mutex> guard(this->lock_);
+  size_t used = 0;
+  for (uint16_t i = 0; i < this->block_count_; i++) {
+    used += this->block_used_[(this->head_block_ + i) % this->blocks_];
+  }
+  return used;
+}
+
+uint32_t HistoryStore::get_record_count() const {
+  std::lock_guard<std::mutex> guard(this->lock_);
+  return this->record_count_;
+}
+
+}  // namespace mbus_meter
+}  // namespace esphome
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace esphome {
+namespace mbus_meter {
+
+// One decoded A1 frame, in the meter's native resolution
+struct HistoryRecord {
+  uint32_t timestamp{0};               // s, epoch if a time source is set, else uptime
+  uint32_t power{0};                   // W
+  uint32_t reactive_power{0};          // VAr
+  uint32_t energy{0};                  // Wh
+  uint32_t reactive_energy{0};         // VArh
+  uint32_t reactive_export_energy{0};  // VArh
+  uint32_t current_l1{0};              // 0.1 A
+  uint32_t current_l2{0};
+  uint32_t current_l3{0};
+  uint32_t voltage_l1{0};  // 0.1 V
+  uint32_t voltage_l2{0};
+  uint32_t voltage_l3{0};
+};
+
+// Read position in a HistoryStore; survives appends and evictions between reads
+struct HistoryCursor {
+  uint32_t block{0};   // sequence number of the block being read
+  uint16_t offset{0};  // bytes of that block already decoded
+  bool started{false};
+  HistoryRecord previous;
+};
+
+// Fixed-size ring of readings. The buffer is split into blocks; each block
+// opens with a record encoded against zero and every following record holds
+// zigzag varint deltas to its predecessor, so dropping the oldest block never
+// orphans a record. Appends and reads may run on different tasks.
+class HistoryStore {
+ public:
+  // The caller owns the buffer, which also holds the per-block bookkeeping.
+  // Returns false if not even one block fits.
+  bool init(uint8_t *buffer, size_t size);
+  void append(const HistoryRecord &record);
+  // Decodes up to max_records records at or after since, oldest first, and
+  // advances the cursor. Returns 0 once the cursor has caught up.
+  size_t read(HistoryCursor *cursor, uint32_t since, HistoryRecord *records, size_t max_records) const;
+
+  size_t get_capacity() const { return static_cast<size_t>(this->blocks_) * BLOCK_SIZE; }
+  size_t get_bytes_used() const;
+  uint32_t get_record_count() const;
+
+  static const uint16_t BLOCK_SIZE = 512;
+  // Buffer bytes needed per block, data plus bookkeeping
+  static const size_t BLOCK_FOOTPRINT = BLOCK_SIZE + 2 * sizeof(uint16_t);
+
+ protected:
+  static size_t encode(const HistoryRecord &record, const HistoryRecord &base, uint8_t *out);
+  static size_t decode(const uint8_t *in, size_t length, const HistoryRecord &base, HistoryRecord *record);
+
+  uint8_t *data_{nullptr};
+  uint16_t *block_used_{nullptr};
+  uint16_t *block_records_{nullptr};
+  uint16_t blocks_{0};
+  uint16_t head_block_{0};
+  uint16_t block_count_{0};
+  uint32_t head_sequence_{0};  // sequence number of the oldest block
+  uint32_t record_count_{0};
+  HistoryRecord last_;
+  mutable std::mutex lock_;
+};
+
+}  // namespace mbus_meter
+}  // namespace esphome
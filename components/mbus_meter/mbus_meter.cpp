@@ -1,6 +1,16 @@
 #include "mbus_meter.h"
+#include "esphome/core/helpers.h"
 #include "esphome/core/log.h"
 
+#include <algorithm>
+#include <cstring>
+
+#ifdef USE_ESP_IDF
+#include <driver/gpio.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#endif
+
 namespace esphome {
 namespace mbus_meter {
 
@@ -10,6 +20,28 @@ void MbusMeter::setup() {
   ESP_LOGCONFIG(TAG, "Setting up Norwegian HAN M-Bus Meter...");
   this->uart_counter_ = 0;
   this->last_frame_time_ = 0;
+  this->scheduler_.reset();
+  this->sleep_window_start_ = millis();
+  if (this->light_sleep_enabled_) this->setup_light_sleep();
+
+  if (this->history_capacity_ > 0) {
+    // Prefer PSRAM when present; failing to allocate must not abort the boot
+    RAMAllocator<uint8_t> allocator;
+    uint8_t *buffer = allocator.allocate(this->history_capacity_);
+    if (!this->history_.init(buffer, this->history_capacity_)) {
+      ESP_LOGE(TAG, "Could not allocate %u bytes of history, history disabled", this->history_capacity_);
+      if (buffer != nullptr) allocator.deallocate(buffer, this->history_capacity_);
+      this->history_capacity_ = 0;
+    }
+  }
+  if (this->capacity_tariff_enabled_) {
+    this->capacity_pref_ = global_preferences->make_preference<CapacityState>(fnv1_hash("mbus_meter_capacity_tariff"));
+    CapacityState state;
+    if (this->capacity_pref_.load(&state)) {
+      this->capacity_.set_state(state);
+      ESP_LOGD(TAG, "Restored capacity tariff state, peak average %.2f kW", this->capacity_.get_peak_average());
+    }
+  }
 }
 
 void MbusMeter::dump_config() {
@@ -28,6 +60,19 @@ void MbusMeter::dump_config() {
   LOG_SENSOR("  ", "Reactive Export Energy", this->reactive_export_energy_sensor_);
   LOG_SENSOR("  ", "Power 2A Frame", this->power_2a_frame_sensor_);
   ESP_LOGCONFIG(TAG, "  Use 2A Frame Own Sensor: %s", this->use_2a_frame_own_sensor_ ? "YES" : "NO");
+  if (this->light_sleep_enabled_) {
+    ESP_LOGCONFIG(TAG, "  Light Sleep: wakeup pin GPIO%u, margin %u ms, min sleep %u ms",
+                  this->light_sleep_wakeup_pin_, this->scheduler_.get_cadence_2a().get_margin_ms(),
+                  this->light_sleep_min_ms_);
+  }
+  if (this->history_capacity_ > 0) ESP_LOGCONFIG(TAG, "  History: %u bytes", this->history_.get_capacity());
+  ESP_LOGCONFIG(TAG, "  Capacity Tariff: %s", this->capacity_tariff_enabled_ ? "YES" : "NO");
+  LOG_SENSOR("  ", "Hour Energy", this->hour_energy_sensor_);
+  LOG_SENSOR("  ", "Hour Energy Projection", this->hour_energy_projection_sensor_);
+  LOG_SENSOR("  ", "Capacity Peak Average", this->capacity_peak_average_sensor_);
+  LOG_SENSOR("  ", "Capacity Step", this->capacity_step_sensor_);
+  LOG_SENSOR("  ", "Duty Cycle", this->duty_cycle_sensor_);
+  LOG_SENSOR("  ", "Sleep Time", this->sleep_time_sensor_);
   LOG_TEXT_SENSOR("  ", "OBIS Version", this->obis_version_text_sensor_);
   LOG_TEXT_SENSOR("  ", "Meter ID", this->meter_id_text_sensor_);
   LOG_TEXT_SENSOR("  ", "Meter Type", this->meter_type_text_sensor_);
@@ -35,6 +80,85 @@ void MbusMeter::dump_config() {
 
 void MbusMeter::loop() {
   this->read_message();
+  if (!this->light_sleep_enabled_) return;
+
+  this->update_sleep_lock();
+  if (millis() - this->sleep_window_start_ >= SLEEP_REPORT_INTERVAL_MS) this->publish_sleep_stats();
+}
+
+void MbusMeter::setup_light_sleep() {
+#ifdef USE_ESP_IDF
+  esp_err_t err = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "mbus_meter", &this->pm_lock_);
+  if (err == ESP_OK) err = esp_pm_lock_acquire(this->pm_lock_);
+
+  // Only let idle time sleep; a fixed clock keeps the UART baud rate stable
+  esp_pm_config_t config = {};
+  config.max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+  config.min_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+  config.light_sleep_enable = true;
+  if (err == ESP_OK) err = esp_pm_configure(&config);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Enabling automatic light sleep failed: %s", esp_err_to_name(err));
+    this->light_sleep_enabled_ = false;
+    return;
+  }
+
+  // UART idles high, so the start bit of an unexpected frame pulls RX low
+  gpio_wakeup_enable(static_cast<gpio_num_t>(this->light_sleep_wakeup_pin_), GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+#endif
+}
+
+void MbusMeter::update_sleep_lock() {
+#ifdef USE_ESP_IDF
+  uint32_t now = millis();
+  uint32_t budget = this->available() > 0 ? 0 : this->scheduler_.sleep_budget(now);
+  // Stay awake while a frame is still coming in
+  if (this->uart_counter_ > 0 && now - this->last_frame_time_ < FRAME_QUIET_MS) budget = 0;
+
+  bool allow = budget >= this->light_sleep_min_ms_;
+  if (allow == this->sleep_allowed_) return;
+
+  // Releasing the lock lets the idle task enter light sleep between loop() calls,
+  // while WiFi modem sleep keeps the station associated
+  uint32_t now_us = micros();
+  if (allow) {
+    ESP_LOGVV(TAG, "Allowing light sleep for %u ms", budget);
+    esp_pm_lock_release(this->pm_lock_);
+  } else {
+    esp_pm_lock_acquire(this->pm_lock_);
+    this->sleep_time_total_us_ += now_us - this->sleep_allowed_since_;
+    this->sleep_time_window_us_ += now_us - this->sleep_allowed_since_;
+  }
+  this->sleep_allowed_since_ = now_us;
+  this->sleep_allowed_ = allow;
+#endif
+}
+
+void MbusMeter::publish_sleep_stats() {
+  uint32_t now = millis();
+  uint32_t window_ms = now - this->sleep_window_start_;
+  if (window_ms == 0) return;
+
+  if (this->sleep_allowed_) {
+    uint32_t now_us = micros();
+    this->sleep_time_total_us_ += now_us - this->sleep_allowed_since_;
+    this->sleep_time_window_us_ += now_us - this->sleep_allowed_since_;
+    this->sleep_allowed_since_ = now_us;
+  }
+
+  // Duty cycle is the share of the window the reader kept the chip awake
+  float asleep_ms = this->sleep_time_window_us_ / 1000.0f;
+  float duty_cycle = 100.0f * (1.0f - asleep_ms / window_ms);
+  if (duty_cycle < 0.0f) duty_cycle = 0.0f;
+  float sleep_time_s = this->sleep_time_total_us_ / 1000000.0f;
+
+  ESP_LOGD(TAG, "Awake duty cycle: %.1f %%, total time sleep allowed: %.0f s", duty_cycle, sleep_time_s);
+  if (this->duty_cycle_sensor_ != nullptr) this->duty_cycle_sensor_->publish_state(duty_cycle);
+  if (this->sleep_time_sensor_ != nullptr) this->sleep_time_sensor_->publish_state(sleep_time_s);
+
+  this->sleep_time_window_us_ = 0;
+  this->sleep_window_start_ = now;
 }
 
 void MbusMeter::reset_buffer() {
@@ -66,13 +190,26 @@ bool MbusMeter::read_message() {
     return false;
   }
 
+  // Any byte while sleep is allowed means the margin was too tight. The RX wakeup
+  // itself garbles the first byte, so this cannot wait for a valid frame header.
+  if (this->sleep_allowed_ && this->available() > 0) {
+    ESP_LOGV(TAG, "UART activity while sleep was allowed - widening wakeup margin");
+    this->scheduler_.record_rx_wakeup(now);
+  }
+
   // Read available bytes into buffer
   while (this->available() > 0 && this->uart_counter_ < sizeof(this->uart_buffer_)) {
     uint8_t byte;
     this->read_byte(&byte);
+    if (this->uart_counter_ == 0) this->frame_start_time_ = now;
     this->last_frame_time_ = now;
     this->uart_buffer_[this->uart_counter_++] = byte;
 
+    // Feed the frame cadence as soon as a valid header is in
+    if (this->uart_counter_ == 3 && this->is_valid_frame_start(0)) {
+      this->scheduler_.record_frame(this->uart_buffer_[0], this->frame_start_time_);
+    }
+
     // Process complete frames based on type and minimum size
     if (this->uart_counter_ >= 20 && this->is_valid_frame_start(0)) {
       if (this->uart_buffer_[0] == 0xA1 && this->uart_counter_ >= 150) {
@@ -123,6 +260,8 @@ void MbusMeter::process_current_frame() {
   if (this->uart_buffer_[0] == 0xA1) {
     ESP_LOGI(TAG, "A1 frame detected, length: %d bytes", this->uart_counter_);
     this->parse_a1_frame();
+    this->record_history();
+    this->update_capacity_tariff();
     return;
   }
 
@@ -433,6 +572,9 @@ void MbusMeter::parse_a1_frame() {
         case 0x01:
           ESP_LOGI(TAG, "A1: Active energy import (1.0.1.8.0.255): %u Wh [raw: %u]", energy_scaled, energy_raw);
           if (this->energy_sensor_ != nullptr) this->energy_sensor_->publish_state(energy_scaled);
+          this->a1_record_.energy = energy_scaled;
+          // The meter sends the counter as double-long-unsigned, shorter values are frame glitches
+          this->a1_energy_received_ = value_length >= 4;
           break;
         case 0x02:
           ESP_LOGI(TAG, "A1: Active energy export (1.0.2.8.0.255): %u Wh [raw: %u]", energy_scaled, energy_raw);
@@ -440,11 +582,13 @@ void MbusMeter::parse_a1_frame() {
         case 0x03:
           ESP_LOGI(TAG, "A1: Reactive energy import (1.0.3.8.0.255): %u VArh [raw: %u]", energy_scaled, energy_raw);
           if (this->reactive_energy_sensor_ != nullptr) this->reactive_energy_sensor_->publish_state(energy_scaled);
+          this->a1_record_.reactive_energy = energy_scaled;
           found_reactive_import = true;
           break;
         case 0x04:
           ESP_LOGI(TAG, "A1: Reactive energy export (1.0.4.8.0.255): %u VArh [raw: %u]", energy_scaled, energy_raw);
           if (this->reactive_export_energy_sensor_ != nullptr) this->reactive_export_energy_sensor_->publish_state(energy_scaled);
+          this->a1_record_.reactive_export_energy = energy_scaled;
           break;
         default:
           ESP_LOGD(TAG, "A1: Unknown energy type 0x%02X: %u [raw: %u]", energy_type, energy_scaled, energy_raw);
@@ -482,6 +626,7 @@ void MbusMeter::parse_a1_frame() {
           if (this->reactive_energy_sensor_ != nullptr) {
             this->reactive_energy_sensor_->publish_state(energy_scaled);
           }
+          this->a1_record_.reactive_energy = energy_scaled;
           break;
         }
       }
@@ -527,6 +672,53 @@ void MbusMeter::parse_a1_frame() {
   }
 }
 
+void MbusMeter::record_history() {
+  if (this->history_capacity_ == 0) return;
+
+  this->a1_record_.timestamp = millis() / 1000;
+#ifdef USE_TIME
+  if (this->history_time_ != nullptr) {
+    ESPTime now = this->history_time_->now();
+    if (now.is_valid()) this->a1_record_.timestamp = now.timestamp;
+  }
+#endif
+  this->history_.append(this->a1_record_);
+  ESP_LOGV(TAG, "History: %u records, %u/%u bytes", this->history_.get_record_count(), this->history_.get_bytes_used(),
+           this->history_.get_capacity());
+}
+
+void MbusMeter::update_capacity_tariff() {
+#ifdef USE_TIME
+  if (!this->capacity_tariff_enabled_ || this->capacity_time_ == nullptr) return;
+  ESPTime now = this->capacity_time_->now();
+  if (!now.is_valid()) return;
+
+  // Hours are closed on the counter only, frames without it just refresh the projection
+  if (this->a1_energy_received_) {
+    this->a1_energy_received_ = false;
+    // Only closed hours are saved, implausible counter readings are dropped by the tracker
+    if (this->capacity_.update(now.timestamp, now.year, now.month, now.day_of_month, this->a1_record_.energy)) {
+      this->capacity_pref_.save(&this->capacity_.get_state());
+      ESP_LOGD(TAG, "Capacity tariff: peak average %.2f kW, step %u", this->capacity_.get_peak_average(),
+               this->capacity_.get_step());
+    }
+  }
+  if (!this->capacity_.is_tracking()) return;
+
+  // Project the rest of the hour at the current power
+  float hour_kwh = this->capacity_.get_hour_energy() / 1000.0f;
+  float remaining_h = (3600 - now.timestamp % 3600) / 3600.0f;
+  float projected_kwh = hour_kwh + this->a1_record_.power / 1000.0f * remaining_h;
+
+  ESP_LOGD(TAG, "Capacity tariff: hour %.2f kWh, projected %.2f kWh", hour_kwh, projected_kwh);
+  if (this->hour_energy_sensor_ != nullptr) this->hour_energy_sensor_->publish_state(hour_kwh);
+  if (this->hour_energy_projection_sensor_ != nullptr) this->hour_energy_projection_sensor_->publish_state(projected_kwh);
+  if (this->capacity_peak_average_sensor_ != nullptr)
+    this->capacity_peak_average_sensor_->publish_state(this->capacity_.get_peak_average());
+  if (this->capacity_step_sensor_ != nullptr) this->capacity_step_sensor_->publish_state(this->capacity_.get_step());
+#endif
+}
+
 uint16_t MbusMeter::find_next_separator(uint16_t start_pos) {
   for (uint16_t i = start_pos; i + 2 < this->uart_counter_; i++) {
     // Standard separator: 02:02:16
@@ -557,6 +749,7 @@ void MbusMeter::parse_a1_obis_value(uint8_t obis_type, uint16_t data_start, uint
         uint32_t power = (this->uart_buffer_[data_start] << 8) | this->uart_buffer_[data_start + 1];
         ESP_LOGI(TAG, "A1: Active power+ (1.0.1.7.0.255): %u W", power);
         if (this->power_sensor_ != nullptr) this->power_sensor_->publish_state(power);
+        this->a1_record_.power = power;
       }
       break;
 
@@ -572,6 +765,7 @@ void MbusMeter::parse_a1_obis_value(uint8_t obis_type, uint16_t data_start, uint
         uint32_t rp = (this->uart_buffer_[data_start] << 8) | this->uart_buffer_[data_start + 1];
         ESP_LOGI(TAG, "A1: Reactive power+ (1.0.3.7.0.255): %u VAr", rp);
         if (this->reactive_power_sensor_ != nullptr) this->reactive_power_sensor_->publish_state(rp);
+        this->a1_record_.reactive_power = rp;
       }
       break;
 
@@ -596,6 +790,10 @@ void MbusMeter::parse_a1_obis_value(uint8_t obis_type, uint16_t data_start, uint
 
         sensor::Sensor *sensors[] = {this->current_l1_sensor_, this->current_l2_sensor_, this->current_l3_sensor_};
         if (sensors[phase - 1] != nullptr) sensors[phase - 1]->publish_state(current_a);
+
+        uint32_t *records[] = {&this->a1_record_.current_l1, &this->a1_record_.current_l2,
+                               &this->a1_record_.current_l3};
+        *records[phase - 1] = current_raw;
       }
       break;
 
@@ -617,6 +815,10 @@ void MbusMeter::parse_a1_obis_value(uint8_t obis_type, uint16_t data_start, uint
 
         sensor::Sensor *sensors[] = {this->voltage_l1_sensor_, this->voltage_l2_sensor_, this->voltage_l3_sensor_};
         if (sensors[phase - 1] != nullptr) sensors[phase - 1]->publish_state(voltage_v);
+
+        uint32_t *records[] = {&this->a1_record_.voltage_l1, &this->a1_record_.voltage_l2,
+                               &this->a1_record_.voltage_l3};
+        *records[phase - 1] = voltage_raw;
       }
       break;
 
@@ -626,5 +828,87 @@ void MbusMeter::parse_a1_obis_value(uint8_t obis_type, uint16_t data_start, uint
   }
 }
 
+#ifdef USE_MBUS_METER_HISTORY
+void HistoryExport::setup() {
+  // MbusMeter has already set up, so a failed allocation is known by now
+  HistoryStore *history = this->parent_->get_history();
+  if (history == nullptr) {
+    this->mark_failed();
+    return;
+  }
+  this->base_->init();
+  this->base_->add_handler(new HistoryHandler(history, this->path_));
+}
+
+void HistoryExport::dump_config() {
+  ESP_LOGCONFIG(TAG, "M-Bus Meter History Export:");
+  ESP_LOGCONFIG(TAG, "  Path: %s", this->path_.c_str());
+  if (this->is_failed()) ESP_LOGCONFIG(TAG, "  History is not available, endpoint disabled");
+}
+
+bool HistoryHandler::canHandle(AsyncWebServerRequest *request) const {
+  return request->method() == HTTP_GET && request->url() == this->path_.c_str();
+}
+
+void HistoryHandler::handleRequest(AsyncWebServerRequest *request) {
+  uint32_t since = 0;
+  if (request->hasParam("since")) {
+    since = strtoul(request->getParam("since")->value().c_str(), nullptr, 10);
+  }
+
+  // Records are formatted a chunk at a time, so the response never has to fit in RAM
+  auto stream = std::make_shared<HistoryCsvStream>(this->store_, since, millis() / 1000);
+#ifdef USE_ESP_IDF
+  httpd_req_t *req = *request;
+  httpd_resp_set_type(req, "text/csv");
+  char chunk[1024];
+  while (size_t length = stream->fill(chunk, sizeof(chunk))) {
+    if (httpd_resp_send_chunk(req, chunk, length) != ESP_OK) return;
+  }
+  httpd_resp_send_chunk(req, nullptr, 0);
+#else
+  request->send(request->beginChunkedResponse(
+      "text/csv", [stream](uint8_t *buffer, size_t max_length, size_t index) -> size_t {
+        return stream->fill(reinterpret_cast<char *>(buffer), max_length);
+      }));
+#endif
+}
+
+HistoryCsvStream::HistoryCsvStream(HistoryStore *store, uint32_t since, uint32_t uptime)
+    : store_(store), since_(since) {
+  // Uptime lets clients place uptime-stamped records on a wall clock
+  char header[64];
+  snprintf(header, sizeof(header), "# uptime=%u records=%u\n", uptime, store->get_record_count());
+  this->line_ = header;
+  this->line_ += "timestamp,power,reactive_power,energy,reactive_energy,reactive_export_energy,"
+                 "current_l1,current_l2,current_l3,voltage_l1,voltage_l2,voltage_l3\n";
+}
+
+size_t HistoryCsvStream::fill(char *buffer, size_t max_length) {
+  size_t length = 0;
+  while (length < max_length) {
+    if (this->line_position_ >= this->line_.size()) {
+      HistoryRecord record;
+      if (this->store_->read(&this->cursor_, this->since_, &record, 1) == 0) break;
+
+      char line[160];
+      int line_length = snprintf(line, sizeof(line), "%u,%u,%u,%u,%u,%u,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+                                 record.timestamp, record.power, record.reactive_power, record.energy,
+                                 record.reactive_energy, record.reactive_export_energy, record.current_l1 / 10.0f,
+                                 record.current_l2 / 10.0f, record.current_l3 / 10.0f, record.voltage_l1 / 10.0f,
+                                 record.voltage_l2 / 10.0f, record.voltage_l3 / 10.0f);
+      this->line_.assign(line, line_length);
+      this->line_position_ = 0;
+    }
+
+    size_t count = std::min(max_length - length, this->line_.size() - this->line_position_);
+    memcpy(buffer + length, this->line_.data() + this->line_position_, count);
+    length += count;
+    this->line_position_ += count;
+  }
+  return length;
+}
+#endif
+
 }  // namespace mbus_meter
 }  // namespace esphome
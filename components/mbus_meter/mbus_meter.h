@@ -1,13 +1,58 @@
 #pragma once
 
 #include "esphome/core/component.h"
+#include "esphome/core/preferences.h"
 #include "esphome/components/sensor/sensor.h"
 #include "esphome/components/text_sensor/text_sensor.h"
 #include "esphome/components/uart/uart.h"
+#include "capacity_tracker.h"
+#include "frame_scheduler.h"
+#include "history_store.h"
+
+#ifdef USE_TIME
+#include "esphome/components/time/real_time_clock.h"
+#endif
+#ifdef USE_ESP_IDF
+#include <esp_pm.h>
+#endif
+#ifdef USE_MBUS_METER_HISTORY
+#include <memory>
+#include "esphome/components/web_server_base/web_server_base.h"
+#endif
 
 namespace esphome {
 namespace mbus_meter {
 
+#ifdef USE_MBUS_METER_HISTORY
+// Produces the CSV export piece by piece from a cursor over the store
+class HistoryCsvStream {
+ public:
+  HistoryCsvStream(HistoryStore *store, uint32_t since, uint32_t uptime);
+  // Fills up to max_length bytes, 0 once everything has been written
+  size_t fill(char *buffer, size_t max_length);
+
+ protected:
+  HistoryStore *store_;
+  uint32_t since_;
+  HistoryCursor cursor_;
+  std::string line_;
+  size_t line_position_{0};
+};
+
+// Streams the stored history as CSV, optionally only records at or after ?since=<timestamp>
+class HistoryHandler : public AsyncWebHandler {
+ public:
+  HistoryHandler(HistoryStore *store, const std::string &path) : store_(store), path_(path) {}
+
+  bool canHandle(AsyncWebServerRequest *request) const override;
+  void handleRequest(AsyncWebServerRequest *request) override;
+
+ protected:
+  HistoryStore *store_;
+  std::string path_;
+};
+#endif
+
 class MbusMeter : public Component, public uart::UARTDevice {
  public:
   MbusMeter() : uart::UARTDevice() {}
@@ -24,11 +69,37 @@ class MbusMeter : public Component, public uart::UARTDevice {
   void set_reactive_export_energy_sensor(sensor::Sensor *sensor) { reactive_export_energy_sensor_ = sensor; }
   void set_power_2a_frame_sensor(sensor::Sensor *sensor) { power_2a_frame_sensor_ = sensor; }
   void set_use_2a_frame_own_sensor(bool use_2a_frame_own_sensor) { use_2a_frame_own_sensor_ = use_2a_frame_own_sensor; }
+  void set_duty_cycle_sensor(sensor::Sensor *sensor) { duty_cycle_sensor_ = sensor; }
+  void set_sleep_time_sensor(sensor::Sensor *sensor) { sleep_time_sensor_ = sensor; }
+  void set_hour_energy_sensor(sensor::Sensor *sensor) { hour_energy_sensor_ = sensor; }
+  void set_hour_energy_projection_sensor(sensor::Sensor *sensor) { hour_energy_projection_sensor_ = sensor; }
+  void set_capacity_peak_average_sensor(sensor::Sensor *sensor) { capacity_peak_average_sensor_ = sensor; }
+  void set_capacity_step_sensor(sensor::Sensor *sensor) { capacity_step_sensor_ = sensor; }
+
+  void set_light_sleep_wakeup_pin(uint8_t pin) {
+    light_sleep_enabled_ = true;
+    light_sleep_wakeup_pin_ = pin;
+  }
+  void set_light_sleep_margin(uint32_t margin_ms) { scheduler_.set_base_margin(margin_ms); }
+  void set_light_sleep_min_duration(uint32_t min_sleep_ms) { light_sleep_min_ms_ = min_sleep_ms; }
+
+  void set_history_capacity(size_t capacity) { history_capacity_ = capacity; }
+#ifdef USE_TIME
+  void set_history_time(time::RealTimeClock *time) { history_time_ = time; }
+  void set_capacity_time(time::RealTimeClock *time) { capacity_time_ = time; }
+#endif
+  void set_capacity_steps(const std::vector<float> &limits) {
+    capacity_tariff_enabled_ = true;
+    capacity_.set_step_limits(limits);
+  }
   
   void set_obis_version_text_sensor(text_sensor::TextSensor *sensor) { obis_version_text_sensor_ = sensor; }
   void set_meter_id_text_sensor(text_sensor::TextSensor *sensor) { meter_id_text_sensor_ = sensor; }
   void set_meter_type_text_sensor(text_sensor::TextSensor *sensor) { meter_type_text_sensor_ = sensor; }
 
+  // nullptr when history is not configured or could not be allocated
+  HistoryStore *get_history() { return history_capacity_ > 0 ? &history_ : nullptr; }
+
   void setup() override;
   void loop() override;
   void dump_config() override;
@@ -50,6 +121,11 @@ class MbusMeter : public Component, public uart::UARTDevice {
   void parse_a1_frame();
   uint16_t find_next_separator(uint16_t start_pos);
   void parse_a1_obis_value(uint8_t obis_type, uint16_t data_start, uint16_t data_end);
+  void setup_light_sleep();
+  void update_sleep_lock();
+  void publish_sleep_stats();
+  void record_history();
+  void update_capacity_tariff();
 
   sensor::Sensor *power_sensor_{nullptr};
   sensor::Sensor *current_l1_sensor_{nullptr};
@@ -63,6 +139,12 @@ class MbusMeter : public Component, public uart::UARTDevice {
   sensor::Sensor *reactive_energy_sensor_{nullptr};
   sensor::Sensor *reactive_export_energy_sensor_{nullptr};
   sensor::Sensor *power_2a_frame_sensor_{nullptr};
+  sensor::Sensor *duty_cycle_sensor_{nullptr};
+  sensor::Sensor *sleep_time_sensor_{nullptr};
+  sensor::Sensor *hour_energy_sensor_{nullptr};
+  sensor::Sensor *hour_energy_projection_sensor_{nullptr};
+  sensor::Sensor *capacity_peak_average_sensor_{nullptr};
+  sensor::Sensor *capacity_step_sensor_{nullptr};
   
   text_sensor::TextSensor *obis_version_text_sensor_{nullptr};
   text_sensor::TextSensor *meter_id_text_sensor_{nullptr};
@@ -71,10 +153,61 @@ class MbusMeter : public Component, public uart::UARTDevice {
   uint8_t uart_buffer_[4096]{0};
   uint16_t uart_counter_{0};
   uint32_t last_frame_time_{0};
+  uint32_t frame_start_time_{0};
   bool use_2a_frame_own_sensor_{false};
 
+  FrameScheduler scheduler_;
+  bool light_sleep_enabled_{false};
+  uint8_t light_sleep_wakeup_pin_{0};
+  uint32_t light_sleep_min_ms_{50};
+  bool sleep_allowed_{false};
+  uint32_t sleep_allowed_since_{0};
+#ifdef USE_ESP_IDF
+  esp_pm_lock_handle_t pm_lock_{nullptr};
+#endif
+  uint64_t sleep_time_total_us_{0};
+  uint64_t sleep_time_window_us_{0};
+  uint32_t sleep_window_start_{0};
+
+  HistoryStore history_;
+  // Latest A1 readings, values missing from a frame carry over from earlier ones
+  HistoryRecord a1_record_;
+  bool a1_energy_received_{false};
+  size_t history_capacity_{0};
+#ifdef USE_TIME
+  time::RealTimeClock *history_time_{nullptr};
+  time::RealTimeClock *capacity_time_{nullptr};
+#endif
+
+  CapacityTracker capacity_;
+  bool capacity_tariff_enabled_{false};
+  ESPPreferenceObject capacity_pref_;
+
   static const uint16_t FRAME_TIMEOUT_MS = 2000;
+  // Silence after the last byte before a partial buffer is treated as a finished frame
+  static const uint16_t FRAME_QUIET_MS = 50;
+  static const uint32_t SLEEP_REPORT_INTERVAL_MS = 60000;
+};
+
+#ifdef USE_MBUS_METER_HISTORY
+// Registers the history endpoint. Kept apart from MbusMeter, which starts reading
+// the UART early, because the HTTP server can only start once the network is up.
+class HistoryExport : public Component {
+ public:
+  HistoryExport(web_server_base::WebServerBase *base, MbusMeter *parent, const std::string &path)
+      : base_(base), parent_(parent), path_(path) {}
+
+  void setup() override;
+  void dump_config() override;
+
+  float get_setup_priority() const override { return setup_priority::WIFI - 1.0f; }
+
+ protected:
+  web_server_base::WebServerBase *base_;
+  MbusMeter *parent_;
+  std::string path_;
 };
+#endif
 
 }  // namespace mbus_meter
 }  // namespace esphome
\ No newline at end of file
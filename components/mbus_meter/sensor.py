@@ -1,23 +1,30 @@
 import esphome.codegen as cg
 import esphome.config_validation as cv
+import esphome.final_validate as fv
 from esphome.components import sensor
 from esphome.const import (
     CONF_ID,
     CONF_POWER,
     CONF_ENERGY,
     DEVICE_CLASS_CURRENT,
+    DEVICE_CLASS_DURATION,
     DEVICE_CLASS_ENERGY,
     DEVICE_CLASS_POWER,
     DEVICE_CLASS_VOLTAGE,
     STATE_CLASS_MEASUREMENT,
     STATE_CLASS_TOTAL_INCREASING,
+    ENTITY_CATEGORY_DIAGNOSTIC,
     UNIT_AMPERE,
+    UNIT_KILOWATT,
+    UNIT_KILOWATT_HOURS,
+    UNIT_PERCENT,
+    UNIT_SECOND,
     UNIT_VOLT,
     UNIT_WATT,
     UNIT_WATT_HOURS,
 )
 
-from . import MbusMeter, mbus_meter_ns
+from . import CONF_CAPACITY_TARIFF, CONF_LIGHT_SLEEP, MbusMeter, mbus_meter_ns
 
 DEPENDENCIES = ["mbus_meter"]
 
@@ -32,6 +39,12 @@ CONF_REACTIVE_ENERGY = "reactive_energy"
 CONF_REACTIVE_EXPORT_ENERGY = "reactive_export_energy"
 CONF_POWER_2A_FRAME = "power_2a_frame"
 CONF_2A_FRAME_OWN_SENSOR = "2a_frame_own_sensor"
+CONF_DUTY_CYCLE = "duty_cycle"
+CONF_SLEEP_TIME = "sleep_time"
+CONF_HOUR_ENERGY = "hour_energy"
+CONF_HOUR_ENERGY_PROJECTION = "hour_energy_projection"
+CONF_CAPACITY_PEAK_AVERAGE = "capacity_peak_average"
+CONF_CAPACITY_STEP = "capacity_step"
 
 CONFIG_SCHEMA = cv.All(
     cv.Schema(
@@ -110,11 +123,67 @@ CONFIG_SCHEMA = cv.All(
             state_class=STATE_CLASS_MEASUREMENT,
         ),
         cv.Optional(CONF_2A_FRAME_OWN_SENSOR, default=False): cv.boolean,
+        cv.Optional(CONF_HOUR_ENERGY): sensor.sensor_schema(
+            unit_of_measurement=UNIT_KILOWATT_HOURS,
+            accuracy_decimals=2,
+            device_class=DEVICE_CLASS_ENERGY,
+            state_class=STATE_CLASS_TOTAL_INCREASING,
+        ),
+        cv.Optional(CONF_HOUR_ENERGY_PROJECTION): sensor.sensor_schema(
+            unit_of_measurement=UNIT_KILOWATT_HOURS,
+            accuracy_decimals=2,
+            state_class=STATE_CLASS_MEASUREMENT,
+        ),
+        cv.Optional(CONF_CAPACITY_PEAK_AVERAGE): sensor.sensor_schema(
+            unit_of_measurement=UNIT_KILOWATT,
+            accuracy_decimals=2,
+            device_class=DEVICE_CLASS_POWER,
+            state_class=STATE_CLASS_MEASUREMENT,
+        ),
+        cv.Optional(CONF_CAPACITY_STEP): sensor.sensor_schema(
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_MEASUREMENT,
+        ),
+        cv.Optional(CONF_DUTY_CYCLE): sensor.sensor_schema(
+            unit_of_measurement=UNIT_PERCENT,
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        cv.Optional(CONF_SLEEP_TIME): sensor.sensor_schema(
+            unit_of_measurement=UNIT_SECOND,
+            accuracy_decimals=0,
+            device_class=DEVICE_CLASS_DURATION,
+            state_class=STATE_CLASS_TOTAL_INCREASING,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
     }
     )
 )
 
 
+
+def _final_validate(config):
+    full_config = fv.full_config.get()
+    parent_path = full_config.get_path_for_id(config[CONF_ID])[:-1]
+    parent_config = full_config.get_config_for_path(parent_path)
+    # Sensors fed by an optional feature would otherwise stay unknown forever
+    requirements = {
+        CONF_DUTY_CYCLE: CONF_LIGHT_SLEEP,
+        CONF_SLEEP_TIME: CONF_LIGHT_SLEEP,
+        CONF_HOUR_ENERGY: CONF_CAPACITY_TARIFF,
+        CONF_HOUR_ENERGY_PROJECTION: CONF_CAPACITY_TARIFF,
+        CONF_CAPACITY_PEAK_AVERAGE: CONF_CAPACITY_TARIFF,
+        CONF_CAPACITY_STEP: CONF_CAPACITY_TARIFF,
+    }
+    for key, feature in requirements.items():
+        if key in config and feature not in parent_config:
+            raise cv.Invalid(f"{key} needs {feature} on the mbus_meter component", path=[key])
+
+
+FINAL_VALIDATE_SCHEMA = _final_validate
+
+
 async def to_code(config):
     parent = await cg.get_variable(config[CONF_ID])
 
@@ -166,4 +235,28 @@ async def to_code(config):
         sens = await sensor.new_sensor(config[CONF_POWER_2A_FRAME])
         cg.add(parent.set_power_2a_frame_sensor(sens))
 
+    if CONF_HOUR_ENERGY in config:
+        sens = await sensor.new_sensor(config[CONF_HOUR_ENERGY])
+        cg.add(parent.set_hour_energy_sensor(sens))
+
+    if CONF_HOUR_ENERGY_PROJECTION in config:
+        sens = await sensor.new_sensor(config[CONF_HOUR_ENERGY_PROJECTION])
+        cg.add(parent.set_hour_energy_projection_sensor(sens))
+
+    if CONF_CAPACITY_PEAK_AVERAGE in config:
+        sens = await sensor.new_sensor(config[CONF_CAPACITY_PEAK_AVERAGE])
+        cg.add(parent.set_capacity_peak_average_sensor(sens))
+
+    if CONF_CAPACITY_STEP in config:
+        sens = await sensor.new_sensor(config[CONF_CAPACITY_STEP])
+        cg.add(parent.set_capacity_step_sensor(sens))
+
+    if CONF_DUTY_CYCLE in config:
+        sens = await sensor.new_sensor(config[CONF_DUTY_CYCLE])
+        cg.add(parent.set_duty_cycle_sensor(sens))
+
+    if CONF_SLEEP_TIME in config:
+        sens = await sensor.new_sensor(config[CONF_SLEEP_TIME])
+        cg.add(parent.set_sleep_time_sensor(sens))
+
     cg.add(parent.set_use_2a_frame_own_sensor(config[CONF_2A_FRAME_OWN_SENSOR]))
\ No newline at end of file
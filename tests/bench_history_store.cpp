@@ -0,0 +1,104 @@
+// Measures HistoryStore encode/decode throughput and bytes per record on the
+// host, using a synthetic A1 trace (one frame every 10 s).
+//
+//   g++ -std=c++17 -O2 -Wall -Icomponents/mbus_meter -o bench_history_store
+//       tests/bench_history_store.cpp components/mbus_meter/history_store.cpp
+//   ./bench_history_store
+
+#include "history_store.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using esphome::mbus_meter::HistoryCursor;
+using esphome::mbus_meter::HistoryRecord;
+using esphome::mbus_meter::HistoryStore;
+
+// Household load as a random walk, with currents and energy following from it
+static std::vector<HistoryRecord> make_trace(size_t count) {
+  std::vector<HistoryRecord> trace;
+  trace.reserve(count);
+  srand(7);
+
+  HistoryRecord record;
+  record.timestamp = 1760000000;
+  record.energy = 48213570;
+  record.reactive_energy = 2871230;
+  record.reactive_export_energy = 915440;
+  int32_t power = 1800;
+  for (size_t i = 0; i < count; i++) {
+    power += rand() % 401 - 200;
+    if (power < 150) power = 150;
+    if (power > 11000) power = 11000;
+
+    record.timestamp += 10;
+    record.power = power;
+    record.reactive_power = 150 + rand() % 60;
+    // Counter resolution is 10 Wh
+    record.energy += (power * 10 / 3600) / 10 * 10;
+    if (i % 30 == 0) record.reactive_energy += 10;
+    if (i % 90 == 0) record.reactive_export_energy += 10;
+    record.voltage_l1 = 2300 + rand() % 21 - 10;
+    record.voltage_l2 = 2310 + rand() % 21 - 10;
+    record.voltage_l3 = 2295 + rand() % 21 - 10;
+    record.current_l1 = power * 10 / 3 / 230 + rand() % 5;
+    record.current_l2 = power * 10 / 3 / 230 + rand() % 5;
+    record.current_l3 = power * 10 / 3 / 230 + rand() % 5;
+    trace.push_back(record);
+  }
+  return trace;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  const size_t buffer_size = 32768;
+  const size_t rounds = 200;
+  std::vector<HistoryRecord> trace = make_trace(5000);
+  std::vector<uint8_t> buffer(buffer_size);
+  HistoryStore store;
+
+  // Encode: fill the store from empty, repeatedly
+  size_t appended = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < rounds; round++) {
+    store.init(buffer.data(), buffer.size());
+    for (const HistoryRecord &record : trace) store.append(record);
+    appended += trace.size();
+  }
+  double encode_s = seconds_since(start);
+
+  // Decode: read everything back through a cursor, as the web export does
+  size_t decoded = 0;
+  HistoryRecord batch[16];
+  start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < rounds; round++) {
+    HistoryCursor cursor;
+    while (size_t count = store.read(&cursor, 0, batch, 16)) decoded += count;
+  }
+  double decode_s = seconds_since(start);
+
+  // The store must hand back the newest records exactly
+  HistoryCursor cursor;
+  size_t index = trace.size() - store.get_record_count();
+  bool exact = true;
+  while (size_t count = store.read(&cursor, 0, batch, 16)) {
+    for (size_t i = 0; i < count; i++) exact &= memcmp(&batch[i], &trace[index++], sizeof(HistoryRecord)) == 0;
+  }
+  exact &= index == trace.size();
+
+  double bytes_per_record = (double) store.get_bytes_used() / store.get_record_count();
+  printf("buffer:           %zu bytes (%zu usable)\n", buffer_size, store.get_capacity());
+  printf("records held:     %u (%.1f h of A1 frames)\n", store.get_record_count(),
+         store.get_record_count() * 10 / 3600.0);
+  printf("bytes per record: %.2f (raw struct %zu)\n", bytes_per_record, sizeof(HistoryRecord));
+  printf("encode:           %.2f M records/s\n", appended / encode_s / 1e6);
+  printf("decode:           %.2f M records/s\n", decoded / decode_s / 1e6);
+  printf("round trip:       %s\n", exact ? "exact" : "MISMATCH");
+  return exact ? 0 : 1;
+}
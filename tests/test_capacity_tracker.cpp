@@ -0,0 +1,158 @@
+// Feeds simulated A1 counter readings through CapacityTracker on the host and
+// checks the monthly peaks, including glitched and reset counters.
+//
+//   g++ -std=c++17 -Wall -Icomponents/mbus_meter -o test_capacity_tracker
+//       tests/test_capacity_tracker.cpp components/mbus_meter/capacity_tracker.cpp
+//   ./test_capacity_tracker
+
+#include "capacity_tracker.h"
+
+#include <cstdio>
+#include <ctime>
+
+using esphome::mbus_meter::CapacityState;
+using esphome::mbus_meter::CapacityTracker;
+
+// 2026-03-01 00:00:00 UTC
+static const uint32_t MONTH_START = 1772323200;
+
+static int failures = 0;
+
+static void check(bool condition, const char *name, const char *what) {
+  if (condition) return;
+  printf("FAIL %s: %s\n", name, what);
+  failures++;
+}
+
+// Dates are taken in UTC, the tracker does not care which zone they come from
+static bool feed(CapacityTracker *tracker, uint32_t timestamp, uint32_t energy_wh) {
+  time_t t = timestamp;
+  struct tm date;
+  gmtime_r(&t, &date);
+  return tracker->update(timestamp, date.tm_year + 1900, date.tm_mon + 1, date.tm_mday, energy_wh);
+}
+
+// One A1 frame every 10 s at a constant power, counter in 10 Wh steps.
+// Returns the number of saves requested.
+static int run_hours(CapacityTracker *tracker, uint32_t *timestamp, uint32_t *energy_wh, uint32_t hours,
+                     uint32_t power_w) {
+  int saves = 0;
+  uint32_t residue = 0;
+  for (uint32_t i = 0; i < hours * 360; i++) {
+    *timestamp += 10;
+    residue += power_w * 10;
+    *energy_wh += residue / 3600 / 10 * 10;
+    residue -= residue / 3600 / 10 * 10 * 3600;
+    if (feed(tracker, *timestamp, *energy_wh)) saves++;
+  }
+  return saves;
+}
+
+static void test_steady_month() {
+  const char *name = "steady month";
+  CapacityTracker tracker;
+  tracker.set_step_limits({2, 5, 10, 15, 20, 25, 50, 75, 100});
+  uint32_t timestamp = MONTH_START;
+  uint32_t energy = 12345670;
+  check(!feed(&tracker, timestamp, energy), name, "saved on start");
+
+  // Day 1 peaks at 6 kW, day 2 at 4 kW, day 3 at 3 kW, day 4 stays at 1 kW
+  const uint32_t peaks[] = {6000, 4000, 3000, 1000};
+  int saves = 0;
+  for (uint32_t peak : peaks) {
+    saves += run_hours(&tracker, &timestamp, &energy, 12, 1000);
+    saves += run_hours(&tracker, &timestamp, &energy, 1, peak);
+    saves += run_hours(&tracker, &timestamp, &energy, 11, 1000);
+  }
+  check(saves == 96, name, "one save per closed hour");
+  // Top three days average (6 + 4 + 3) / 3 kWh/h, less a little for the 10 Wh counter steps
+  float average = tracker.get_peak_average();
+  check(average > 4.31f && average < 4.34f, name, "peak average");
+  check(tracker.get_step() == 2, name, "tariff step");
+}
+
+static void test_glitched_reading() {
+  const char *name = "glitched reading";
+  CapacityTracker tracker;
+  uint32_t timestamp = MONTH_START;
+  uint32_t energy = 12345670;
+  feed(&tracker, timestamp, energy);
+
+  // A zero and a short 2-byte value in the middle of the hour
+  check(!feed(&tracker, timestamp + 10, 0), name, "saved a zero reading");
+  check(!feed(&tracker, timestamp + 20, 6553), name, "saved a short reading");
+  check(!feed(&tracker, timestamp + 30, 12345680), name, "saved mid-hour");
+  check(tracker.get_state().hour_start_energy == 12345670, name, "hour restarted");
+  check(tracker.get_hour_energy() == 10, name, "hour energy");
+
+  // An implausible jump forward, 1 MWh in 10 s
+  check(!feed(&tracker, timestamp + 40, 13345680), name, "saved a jump");
+  check(tracker.get_hour_energy() == 10, name, "jump counted");
+
+  timestamp += 40;
+  energy = 12345680;
+  run_hours(&tracker, &timestamp, &energy, 2, 2000);
+  float average = tracker.get_peak_average();
+  check(average > 1.98f && average < 2.02f, name, "peak average");
+}
+
+static void test_counter_reset() {
+  const char *name = "counter reset";
+  CapacityTracker tracker;
+  uint32_t timestamp = MONTH_START;
+  uint32_t energy = 12345670;
+  feed(&tracker, timestamp, energy);
+  run_hours(&tracker, &timestamp, &energy, 2, 2000);
+
+  // A replaced meter starts over from zero and is followed after a few minutes
+  energy = 0;
+  int saves = run_hours(&tracker, &timestamp, &energy, 2, 3000);
+  check(saves == 2, name, "hours closed after reset");
+  check(tracker.get_state().hour_start_energy < 12345670, name, "new counter followed");
+  // Only the best hour of the day counts, here a full hour on the new counter
+  float average = tracker.get_peak_average();
+  check(average > 2.98f && average < 3.02f, name, "peak average");
+}
+
+static void test_restore() {
+  const char *name = "restore";
+  CapacityTracker tracker;
+  uint32_t timestamp = MONTH_START;
+  uint32_t energy = 12345670;
+  feed(&tracker, timestamp, energy);
+  run_hours(&tracker, &timestamp, &energy, 3, 5000);
+  CapacityState saved = tracker.get_state();
+
+  // Reboot 20 minutes later with a glitched first reading
+  CapacityTracker restored;
+  restored.set_state(saved);
+  timestamp += 1200;
+  energy += 1660;
+  check(!feed(&restored, timestamp, 0), name, "saved a zero reading");
+  run_hours(&restored, &timestamp, &energy, 2, 5000);
+  float average = restored.get_peak_average();
+  check(average > 4.98f && average < 5.02f, name, "peak average");
+}
+
+static void test_month_change() {
+  const char *name = "month change";
+  CapacityTracker tracker;
+  uint32_t timestamp = MONTH_START - 2 * 3600;
+  uint32_t energy = 12345670;
+  feed(&tracker, timestamp, energy);
+  run_hours(&tracker, &timestamp, &energy, 1, 9000);
+  run_hours(&tracker, &timestamp, &energy, 3, 1000);
+  float average = tracker.get_peak_average();
+  check(average > 0.98f && average < 1.02f, name, "previous month cleared");
+}
+
+int main() {
+  test_steady_month();
+  test_glitched_reading();
+  test_counter_reset();
+  test_restore();
+  test_month_change();
+
+  if (failures == 0) printf("All capacity tracker tests passed\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+// Replays simulated 2A/A1 frame traces through FrameScheduler on the host and
+// checks that it never allows sleep across a frame arrival.
+//
+//   g++ -std=c++17 -Wall -Icomponents/mbus_meter -o test_frame_scheduler
+//       tests/test_frame_scheduler.cpp components/mbus_meter/frame_scheduler.cpp
+//   ./test_frame_scheduler
+
+#include "frame_scheduler.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using esphome::mbus_meter::FrameScheduler;
+
+struct Frame {
+  uint32_t time;
+  uint8_t type;
+  bool on_grid;  // off-grid frames cannot be predicted and may be slept through
+};
+
+struct TraceOptions {
+  uint32_t start;           // clock value of the first frame
+  uint32_t duration;        // ms
+  uint32_t a1_offset;       // A1 phase relative to the 2A grid, ms
+  uint32_t jitter;          // +/- ms per frame
+  bool with_2a;
+  bool drop_frames;         // lose roughly one frame in 40
+  bool hourly_extra_frame;  // an off-grid A1 frame every 15 minutes
+};
+
+static std::vector<Frame> make_trace(const TraceOptions &options) {
+  std::vector<Frame> frames;
+  srand(42);
+  auto jitter = [&]() -> int32_t {
+    if (options.jitter == 0) return 0;
+    return (int32_t) (rand() % (2 * options.jitter + 1)) - (int32_t) options.jitter;
+  };
+  for (uint32_t t = 0; t < options.duration; t += 2500) {
+    bool drop = options.drop_frames && rand() % 40 == 0;
+    if (options.with_2a && !drop) frames.push_back({options.start + t + jitter(), 0x2A, true});
+    if (t % 10000 == 0 && !drop) frames.push_back({options.start + t + options.a1_offset + jitter(), 0xA1, true});
+    if (options.hourly_extra_frame && t % 900000 == 500000) frames.push_back({options.start + t + 1700, 0xA1, false});
+  }
+  return frames;
+}
+
+static int failures = 0;
+
+static void check(bool condition, const char *name, const char *what) {
+  if (condition) return;
+  printf("FAIL %s: %s\n", name, what);
+  failures++;
+}
+
+// Steps a simulated clock through the trace, 5 ms at a time while awake, and
+// jumps forward by the sleep budget whenever the scheduler allows sleep
+static void run(const char *name, const TraceOptions &options) {
+  std::vector<Frame> frames = make_trace(options);
+  FrameScheduler scheduler;
+  scheduler.set_base_margin(100);
+
+  uint32_t now = options.start;
+  uint32_t end = options.start + options.duration;
+  size_t next = 0;
+  uint64_t asleep = 0;
+  uint32_t overslept = 0;
+
+  while ((int32_t) (end - now) > 0) {
+    while (next < frames.size() && (int32_t) (now - frames[next].time) >= 0) {
+      scheduler.record_frame(frames[next].type, frames[next].time);
+      next++;
+    }
+
+    uint32_t budget = scheduler.sleep_budget(now);
+    if (budget < 50) {
+      now += 5;
+      continue;
+    }
+    if (next < frames.size() && (int32_t) (frames[next].time - now) < (int32_t) budget) {
+      if (frames[next].on_grid) overslept++;
+      // Like an RX wakeup on the device: the header is garbled, so the frame is
+      // lost and only the activity itself reaches the scheduler
+      budget = frames[next].time - now;
+      scheduler.record_rx_wakeup(frames[next].time);
+      next++;
+    }
+    asleep += budget;
+    now += budget;
+  }
+
+  float sleep_share = 100.0f * asleep / options.duration;
+  printf("%-24s 2A %7.1f ms, A1 %7.1f ms, asleep %4.1f %%, overslept %u\n", name,
+         scheduler.get_cadence_2a().get_period_ms(), scheduler.get_cadence_a1().get_period_ms(), sleep_share,
+         overslept);
+
+  check(overslept == 0, name, "slept past a frame");
+  if (options.with_2a) check(fabsf(scheduler.get_cadence_2a().get_period_ms() - 2500.0f) < 25.0f, name, "2A period");
+  check(fabsf(scheduler.get_cadence_a1().get_period_ms() - 10000.0f) < 100.0f, name, "A1 period");
+  check(sleep_share > 40.0f, name, "too little sleep");
+}
+
+// RX activity carries no frame type, so it must widen the cadence that was due
+static void test_rx_wakeup() {
+  const char *name = "rx wakeup attribution";
+  FrameScheduler scheduler;
+  scheduler.set_base_margin(100);
+  uint32_t now = 1000;
+  for (; now < 1000 + 120000; now += 2500) {
+    scheduler.record_frame(0x2A, now);
+    if ((now - 1000) % 10000 == 0) scheduler.record_frame(0xA1, now + 1250);
+  }
+  uint32_t margin_2a = scheduler.get_cadence_2a().get_margin_ms();
+  uint32_t margin_a1 = scheduler.get_cadence_a1().get_margin_ms();
+
+  // Last A1 went out at 1000 + 110000 + 1250; wake 60 ms before the next one is due
+  scheduler.record_rx_wakeup(1000 + 120000 + 1250 - 60);
+  check(scheduler.get_cadence_a1().get_margin_ms() > margin_a1, name, "A1 margin not widened");
+  check(scheduler.get_cadence_2a().get_margin_ms() == margin_2a, name, "2A margin widened");
+
+  // Before anything is locked, every cadence seen so far is widened
+  FrameScheduler fresh;
+  fresh.set_base_margin(100);
+  fresh.record_frame(0x2A, 1000);
+  fresh.record_frame(0xA1, 1500);
+  fresh.record_rx_wakeup(2000);
+  check(fresh.get_cadence_2a().get_margin_ms() > 100, name, "unlocked 2A margin not widened");
+  check(fresh.get_cadence_a1().get_margin_ms() > 100, name, "unlocked A1 margin not widened");
+}
+
+int main() {
+  const uint32_t hour = 3600000;
+  run("a1 between 2a", {1000, hour, 1250, 20, true, false, false});
+  run("a1 right after 2a", {1000, hour, 80, 20, true, false, false});
+  run("a1 only", {1000, hour, 0, 20, false, false, false});
+  run("dropped frames", {1000, hour, 1250, 20, true, true, false});
+  run("off-grid extra a1", {1000, hour, 1250, 0, true, false, true});
+  run("millis wraparound", {UINT32_MAX - 600000, hour, 1250, 20, true, false, false});
+  test_rx_wakeup();
+
+  if (failures == 0) printf("All frame scheduler tests passed\n");
+  return failures == 0 ? 0 : 1;
+}